@@ -28,7 +28,8 @@ static void open_codec(int *stream_index, AVCodecContext **dec_ctx, AVFormatCont
 	assert(ret == 0);
 }
 
-static void decode_packet(
+// Returns the first nonzero callback result, 0 if there was none.
+static int decode_packet(
 	AVCodecContext *dec_ctx,
 	AVFrame *frame,
 	const AVPacket *packet,
@@ -48,14 +49,15 @@ static void decode_packet(
 
 		if (dec_ctx->codec->type == AVMEDIA_TYPE_VIDEO) {
 			ret = on_vframe(frame->data[0], frame->format, frame->width, frame->height, frame->linesize[0], userdata);
-			assert(ret == 0);
 		} else if (dec_ctx->codec->type == AVMEDIA_TYPE_AUDIO) {
 			ret = on_aframe(frame->data, frame->format, frame->ch_layout.nb_channels, frame->nb_samples, userdata);
-			assert(ret == 0);
 		}
 
 		av_frame_unref(frame);
+		if (ret != 0)
+			return ret;
 	}
+	return 0;
 }
 
 AVDecodeInfo avdecode_prepare(const char *filename) {
@@ -102,18 +104,21 @@ void avdecode_run(
 	AVPacket *packet = av_packet_alloc();
 	assert(packet);
 
-	while (av_read_frame(info.priv->fmt_ctx, packet) >= 0) {
+	int stop = 0;
+	while (!stop && av_read_frame(info.priv->fmt_ctx, packet) >= 0) {
 		if (packet->stream_index == info.priv->video_stream_index) {
-			decode_packet(info.priv->video_dec_ctx, frame, packet, on_vframe, on_aframe, userdata);
+			stop = decode_packet(info.priv->video_dec_ctx, frame, packet, on_vframe, on_aframe, userdata);
 		} else if (packet->stream_index == info.priv->audio_stream_index) {
-			decode_packet(info.priv->audio_dec_ctx, frame, packet, on_vframe, on_aframe, userdata);
+			stop = decode_packet(info.priv->audio_dec_ctx, frame, packet, on_vframe, on_aframe, userdata);
 		}
 
 		av_packet_unref(packet);
 	}
 
-	decode_packet(info.priv->video_dec_ctx, frame, NULL, on_vframe, on_aframe, userdata);
-	decode_packet(info.priv->audio_dec_ctx, frame, NULL, on_vframe, on_aframe, userdata);
+	if (!stop)
+		stop = decode_packet(info.priv->video_dec_ctx, frame, NULL, on_vframe, on_aframe, userdata);
+	if (!stop)
+		decode_packet(info.priv->audio_dec_ctx, frame, NULL, on_vframe, on_aframe, userdata);
 
 	avcodec_free_context(&info.priv->video_dec_ctx);
 	avcodec_free_context(&info.priv->audio_dec_ctx);
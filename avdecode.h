@@ -20,6 +20,7 @@ typedef struct AVDecodeInfo {
 
 AVDecodeInfo avdecode_prepare(const char *filename);
 
+// Decodes the whole file, unless a callback returns nonzero to stop early.
 void avdecode_run(
 	AVDecodeInfo info,
 	int (*on_vframe)(uint8_t *data, enum AVPixelFormat format, int width, int height, int linesize, void *userdata),
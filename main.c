@@ -11,26 +11,28 @@
 #include <pthread.h>
 #include <stdatomic.h>
 
-#include "rng.h"
 #include "circbuf.h"
 #include "avdecode.h"
+#include "sink.h"
+#include "render.h"
+#include "renderahead.h"
 
 #define DEBUGINF_PERIOD 100
-
-static uint32_t rgba_to_u32(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-		return r << 24 | g << 16 | b << 8 | a;
-}
-
-static uint32_t random_color_u32(RNG *rng) {
-	return (rng_u64(rng) & 0xFFFFFF00) | 0xFF;
-}
+#define RENDER_AHEAD_FRAMES 8
+#define NOISE_TILE_SIZE 128
 
 static CircBuf *audiobuf = NULL;
 static atomic_size_t audio_pos; // in bytes
 static atomic_size_t audio_len; // in bytes
+static atomic_uint_fast64_t audio_cb_ticks; // SDL_GetTicks64() at the last audio callback
+
+static bool audio_enabled = true; // audio is dropped when not playing in real time
 
 static CircBuf *videobuf = NULL;
 static atomic_size_t video_n_frames;
+static atomic_bool decode_done;
+static RenderAhead *render_ahead = NULL;
+static uint32_t frame_ready_event; // pushed whenever render_ahead finished a frame
 
 static void audio_callback(void *userdata, uint8_t *stream, int len) {
 	AVDecodeInfo *avinfo = (AVDecodeInfo*)userdata;
@@ -40,86 +42,66 @@ static void audio_callback(void *userdata, uint8_t *stream, int len) {
 	int silence = (avinfo->a_format == AV_SAMPLE_FMT_U8 || avinfo->a_format == AV_SAMPLE_FMT_U8P) ? 0x80 : 0;
 	memset(stream + n, silence, len-n);
 	atomic_fetch_add(&audio_pos, n);
+	atomic_store(&audio_cb_ticks, SDL_GetTicks64());
+}
+
+// Playback position in seconds. audio_pos only advances once per callback
+// and already counts the period just handed to the device, so the clock
+// starts one period back and adds the time since the last callback (capped
+// to one period), never running ahead of what is playing.
+static double get_audio_time(SDL_AudioDeviceID audiodev, const SDL_AudioSpec *aspec, const AVDecodeInfo *avinfo, bool paused) {
+	size_t bytes_per_sec = aspec->freq * avinfo->a_n_channels * avinfo->a_sample_size;
+	// The callback runs with the device locked, so position and tick match.
+	SDL_LockAudioDevice(audiodev);
+	size_t pos = atomic_load(&audio_pos);
+	uint64_t cb_ticks = atomic_load(&audio_cb_ticks);
+	SDL_UnlockAudioDevice(audiodev);
+	double period = (double)aspec->samples / (double)aspec->freq;
+	double t = (double)pos / (double)bytes_per_sec - period;
+	if (!paused) {
+		double since_cb = (double)(SDL_GetTicks64() - cb_ticks) / 1000.0;
+		t += since_cb < period ? since_cb : period;
+	}
+	return t > 0.0 ? t : 0.0;
 }
 
 int on_vframe(uint8_t *data, enum AVPixelFormat format, int width, int height, int linesize, void *userdata) {
 	//printf("saving frame %llu, fmt: %s, %d\n", videobuf_frames, av_get_pix_fmt_name(format), linesize);
 	//fflush(stdout);
+	// Fails once main closed the buffer to stop decoding.
 	for (int i = 0; i < height; ++i) {
-		circ_buf_write(videobuf, data + i*linesize, width);
+		if (circ_buf_write(videobuf, data + i*linesize, width) != 0)
+			return 1;
 	}
 	atomic_fetch_add(&video_n_frames, 1);
+	render_ahead_frame_decoded(render_ahead);
 	return 0;
 }
 
 int on_aframe(uint8_t **data, enum AVSampleFormat format, int n_channels, int n_samples, void *userdata) {
+	if (!audio_enabled)
+		return 0;
 	size_t data_size = av_get_bytes_per_sample(format);
 	//printf("ch: %d, fmt: %s\n", n_channels, av_get_sample_fmt_name(format));
 	//fflush(stdout);
 	if (av_sample_fmt_is_planar(format)) {
 		for (int i = 0; i < n_samples; ++i) {
 			for (int ch = 0; ch < n_channels; ++ch) {
-				circ_buf_write(audiobuf, data[ch] + data_size*i, data_size);
+				if (circ_buf_write(audiobuf, data[ch] + data_size*i, data_size) != 0)
+					return 1;
 			}
 		}
 	} else {
-		circ_buf_write(audiobuf, data[0], n_samples * n_channels * data_size);
+		if (circ_buf_write(audiobuf, data[0], n_samples * n_channels * data_size) != 0)
+			return 1;
 	}
 	atomic_fetch_add(&audio_len, n_samples * n_channels * data_size);
 	return 0;
 }
 
-void img_draw_autostereogram(uint32_t *dst, uint8_t *src, int width, int height, int eyedist /*in pixels*/, double close_ratio, RNG *rng) {
-	uint32_t *pix = malloc(sizeof(int) * width);
-	int *same = malloc(sizeof(int) * width);
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x)
-			same[x] = x;
-
-		for (int x = 0; x < width; ++x) {
-			double val = (double)src[y*width + x] / 255.0;
-			int s = round((1-close_ratio*val)*eyedist/(2-close_ratio*val));
-			int left = x - s/2;
-			int right = left + s;
-			if (left < 0 || right >= width)
-				continue;
-			bool visible = false;
-			int t = 1;
-			double zt;
-
-			do {
-				if (x-t < 0 || x+t > width)
-					break;
-				double vall = (double)src[y*width + (x-t)] / 255.0;
-				double valr = (double)src[y*width + (x+t)] / 255.0;
-				zt = val + 2*(2-close_ratio*val)*t/(close_ratio*eyedist);
-				visible = vall < zt && valr < zt;
-				++t;
-			} while (visible && zt < 1);
-			if (visible) {
-				int l = same[left];
-				while (l != left && l != right) {
-					if (l < right) {
-						left = l;
-						l = same[left];
-					} else {
-						same[left] = right;
-						left = right;
-						l = same[left];
-						right = l;
-					}
-				}
-				same[left] = right;
-			}
-		}
-		for (int x = width-1; x >= 0; --x) {
-			if (same[x] == x) pix[x] = rng_bool(rng, 0.5) ? rgba_to_u32(255, 255, 255, 255) : rgba_to_u32(0, 0, 0, 255);// random_color_u32(rng);
-			else pix[x] = pix[same[x]];
-			dst[y*width + x] = pix[x];
-		}
-	}
-	free(same);
-	free(pix);
+static void on_frame_ready(void *userdata) {
+	SDL_Event evt = { .type = frame_ready_event };
+	SDL_PushEvent(&evt);
 }
 
 typedef struct {
@@ -130,41 +112,193 @@ typedef struct {
 static void *thread_decode(void *vargp) {
 	ThreadDecodeData *data = (ThreadDecodeData*)vargp;
 	avdecode_run(data->avinfo, on_vframe, on_aframe, data->userdata);
+	atomic_store(&decode_done, true);
 	return NULL;
 }
 
-int main(void) {
-	AVDecodeInfo avinfo = avdecode_prepare("bad-apple.mp4");
+// Size to render at, 0 for the video size.
+static void get_output_size(Sink *sink, const AVDecodeInfo *avinfo, bool display_res, int *width, int *height) {
+	*width = *height = 0;
+	if (display_res && !sink_get_size(sink, width, height)) {
+		*width = avinfo->v_width*2;
+		*height = avinfo->v_height*2;
+	}
+}
 
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
-		printf("SDL_Init failed: %s\n", SDL_GetError());
-		return 1;
+// Loads a BMP image as pattern tile. Returns NULL on failure.
+static PatternTile *load_pattern_tile(const char *path) {
+	SDL_Surface *img = SDL_LoadBMP(path);
+	if (!img) {
+		fprintf(stderr, "SDL_LoadBMP failed: %s\n", SDL_GetError());
+		return NULL;
+	}
+	SDL_Surface *rgba = SDL_ConvertSurfaceFormat(img, SDL_PIXELFORMAT_RGBA8888, 0);
+	SDL_FreeSurface(img);
+	if (!rgba) {
+		fprintf(stderr, "SDL_ConvertSurfaceFormat failed: %s\n", SDL_GetError());
+		return NULL;
 	}
-	SDL_Window *win = SDL_CreateWindow("Stereogram", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, avinfo.v_width*2, avinfo.v_height*2, SDL_WINDOW_RESIZABLE);
-	if (!win) {
-		printf("SDL_CreateWindow failed: %s\n", SDL_GetError());
+	PatternTile *tile = pattern_tile_create(rgba->w, rgba->h);
+	if (tile) {
+		for (int y = 0; y < rgba->h; ++y)
+			memcpy(tile->px + y*rgba->w, (uint8_t*)rgba->pixels + y*rgba->pitch, sizeof(uint32_t) * rgba->w);
+	} else {
+		fprintf(stderr, "pattern_tile_create failed\n");
+	}
+	SDL_FreeSurface(rgba);
+	return tile;
+}
+
+static void print_usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-s sdl|y4m|rgba|null] [-o output] [-r] [-i] [-g gamma] [-c min:max] [-q levels] [-b radius | -M] [-p dots|noise|tile.bmp]\n", prog);
+	fprintf(stderr, "  -s  output sink (default: sdl)\n");
+	fprintf(stderr, "  -o  output file or named pipe for y4m/rgba (default: stdout)\n");
+	fprintf(stderr, "  -r  render at window size instead of video size (twice the video size for other sinks)\n");
+	fprintf(stderr, "  -i  invert depth\n");
+	fprintf(stderr, "  -g  depth gamma, above 0 (default: 1.0)\n");
+	fprintf(stderr, "  -c  luma range stretched to the full depth range (default: 0:255)\n");
+	fprintf(stderr, "  -q  quantize depth to this many levels, at least 2\n");
+	fprintf(stderr, "  -b  box smoothing of the depth map, radius 1 to %d\n", DEPTH_BOX_MAX_RADIUS);
+	fprintf(stderr, "  -M  3x3 median smoothing of the depth map\n");
+	fprintf(stderr, "  -p  stereogram pattern: random dots, colored noise or a BMP image (default: dots)\n");
+}
+
+int main(int argc, char **argv) {
+	const char *sink_name = "sdl";
+	const char *out_path = NULL;
+	bool display_res = false;
+	DepthParams depth_params = depth_params_default();
+	const char *pattern_name = "dots";
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+			sink_name = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+			out_path = argv[++i];
+		else if (strcmp(argv[i], "-r") == 0)
+			display_res = true;
+		else if (strcmp(argv[i], "-i") == 0)
+			depth_params.invert = true;
+		else if (strcmp(argv[i], "-g") == 0 && i+1 < argc) {
+			depth_params.gamma = atof(argv[++i]);
+			if (depth_params.gamma <= 0.0) {
+				print_usage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) {
+			int min, max;
+			if (sscanf(argv[++i], "%d:%d", &min, &max) != 2 || min < 0 || max > 255 || min >= max) {
+				print_usage(argv[0]);
+				return 1;
+			}
+			depth_params.min = min;
+			depth_params.max = max;
+		} else if (strcmp(argv[i], "-q") == 0 && i+1 < argc) {
+			depth_params.levels = atoi(argv[++i]);
+			if (depth_params.levels < 2) {
+				print_usage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) {
+			depth_params.smooth = DEPTH_SMOOTH_BOX;
+			depth_params.smooth_radius = atoi(argv[++i]);
+			if (depth_params.smooth_radius < 1 || depth_params.smooth_radius > DEPTH_BOX_MAX_RADIUS) {
+				print_usage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-M") == 0) {
+			depth_params.smooth = DEPTH_SMOOTH_MEDIAN;
+			depth_params.smooth_radius = DEPTH_MEDIAN_MAX_RADIUS;
+		} else if (strcmp(argv[i], "-p") == 0 && i+1 < argc)
+			pattern_name = argv[++i];
+		else {
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+	// The window shows frames to a viewer and is paced by the audio clock,
+	// all other sinks get every frame as fast as possible.
+	bool realtime = strcmp(sink_name, "sdl") == 0;
+	if (!realtime && strcmp(sink_name, "y4m") != 0 && strcmp(sink_name, "rgba") != 0 && strcmp(sink_name, "null") != 0) {
+		print_usage(argv[0]);
 		return 1;
 	}
-	SDL_Renderer *rend = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (!rend) {
-		printf("SDL_CreateRenderer failed: %s\n", SDL_GetError());
+
+	AVDecodeInfo avinfo = avdecode_prepare("bad-apple.mp4");
+
+	// Without a real-time sink, frames are rendered as fast as possible
+	// and neither a display nor an audio device is needed.
+	if (SDL_Init(realtime ? SDL_INIT_VIDEO | SDL_INIT_AUDIO : SDL_INIT_EVENTS) != 0) {
+		fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
 		return 1;
 	}
-	SDL_Texture *tex = SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, avinfo.v_width, avinfo.v_height);
-	if (!tex) {
-		printf("SDL_CreateTexture failed: %s\n", SDL_GetError());
+	audio_enabled = realtime;
+
+	Sink *sink;
+	if (strcmp(sink_name, "sdl") == 0)
+		sink = sink_sdl_create("Stereogram", avinfo.v_width*2, avinfo.v_height*2);
+	else if (strcmp(sink_name, "y4m") == 0)
+		sink = sink_y4m_create(out_path, avinfo.v_fps);
+	else if (strcmp(sink_name, "rgba") == 0)
+		sink = sink_rgba_create(out_path);
+	else
+		sink = sink_null_create();
+	if (!sink) {
+		fprintf(stderr, "creating %s sink failed\n", sink_name);
 		return 1;
 	}
 
 	audiobuf = circ_buf_create(52428800);
 	if (!audiobuf) {
-		printf("circ_buf_create failed\n");
+		fprintf(stderr, "circ_buf_create failed\n");
 		return 1;
 	}
 
 	videobuf = circ_buf_create(104857600);
 	if (!videobuf) {
-		printf("circ_buf_create failed\n");
+		fprintf(stderr, "circ_buf_create failed\n");
+		return 1;
+	}
+
+	// Patterns cycled through with p: dots (NULL), noise and the image if given
+	PatternTile *patterns[3] = { NULL };
+	int n_patterns = 1;
+	int pattern = 0;
+	patterns[n_patterns++] = pattern_tile_noise(NOISE_TILE_SIZE, NOISE_TILE_SIZE, 0);
+	if (!patterns[1]) {
+		fprintf(stderr, "pattern_tile_noise failed\n");
+		return 1;
+	}
+	if (strcmp(pattern_name, "noise") == 0)
+		pattern = 1;
+	else if (strcmp(pattern_name, "dots") != 0) {
+		patterns[n_patterns] = load_pattern_tile(pattern_name);
+		if (!patterns[n_patterns])
+			return 1;
+		pattern = n_patterns++;
+	}
+
+	bool stereogram = true;
+	int eyedist = 120;
+	int close_ratio_den = 8;
+	RenderParams params = {
+		.stereogram = stereogram,
+		.eyedist = eyedist,
+		.close_ratio = 1.0/(double)close_ratio_den,
+		.depth = depth_params,
+		.pattern = patterns[pattern],
+	};
+	get_output_size(sink, &avinfo, display_res, &params.out_width, &params.out_height);
+
+	// Keep one core for decoding and one for presenting.
+	int n_workers = SDL_GetCPUCount() - 2;
+	if (n_workers < 1)
+		n_workers = 1;
+	else if (n_workers > RENDER_AHEAD_FRAMES)
+		n_workers = RENDER_AHEAD_FRAMES;
+	frame_ready_event = SDL_RegisterEvents(1);
+	render_ahead = render_ahead_create(videobuf, avinfo.v_width, avinfo.v_height, &params, RENDER_AHEAD_FRAMES, n_workers, on_frame_ready, NULL);
+	if (!render_ahead) {
+		fprintf(stderr, "render_ahead_create failed\n");
 		return 1;
 	}
 
@@ -176,43 +310,40 @@ int main(void) {
 	};
 	int ret = pthread_create(&thread_decode_id, NULL, thread_decode, &thread_decode_data);
 	if (ret) {
-		printf("pthread_create failed: %s\n", strerror(ret));
+		fprintf(stderr, "pthread_create failed: %s\n", strerror(ret));
 		return 1;
 	}
 
-	SDL_AudioSpec spec = {0}, aspec;
-	spec.freq = avinfo.a_sample_rate;
-	switch (avinfo.a_format) {
-	case AV_SAMPLE_FMT_U8:   spec.format = AUDIO_U8;     break;
-	case AV_SAMPLE_FMT_S16:  spec.format = AUDIO_S16SYS; break;
-	case AV_SAMPLE_FMT_S32:  spec.format = AUDIO_S32SYS; break;
-	case AV_SAMPLE_FMT_FLT:  spec.format = AUDIO_F32SYS; break;
-	case AV_SAMPLE_FMT_U8P:  spec.format = AUDIO_U8;     break;
-	case AV_SAMPLE_FMT_S16P: spec.format = AUDIO_S16SYS; break;
-	case AV_SAMPLE_FMT_S32P: spec.format = AUDIO_S32SYS; break;
-	case AV_SAMPLE_FMT_FLTP: spec.format = AUDIO_F32SYS; break;
-	default:
-		printf("unsupported audio format: %s\n", av_get_sample_fmt_name(avinfo.a_format));
-		return 1;
-	}
-	spec.channels = avinfo.a_n_channels;
-	spec.samples = 1024;
-	spec.callback = audio_callback;
-	spec.userdata = &avinfo;
-
-	int audiodev = SDL_OpenAudioDevice(NULL, 0, &spec, &aspec, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
-	assert(audiodev > 0);
-	SDL_PauseAudioDevice(audiodev, 0);
-
-	uint32_t *pxdata = malloc(sizeof(uint32_t) * avinfo.v_height * avinfo.v_width);
-	if (!pxdata) {
-		printf("malloc failed\n");
-		return 1;
+	SDL_AudioSpec spec = {0}, aspec = {0};
+	int audiodev = 0;
+	if (realtime) {
+		spec.freq = avinfo.a_sample_rate;
+		switch (avinfo.a_format) {
+		case AV_SAMPLE_FMT_U8:   spec.format = AUDIO_U8;     break;
+		case AV_SAMPLE_FMT_S16:  spec.format = AUDIO_S16SYS; break;
+		case AV_SAMPLE_FMT_S32:  spec.format = AUDIO_S32SYS; break;
+		case AV_SAMPLE_FMT_FLT:  spec.format = AUDIO_F32SYS; break;
+		case AV_SAMPLE_FMT_U8P:  spec.format = AUDIO_U8;     break;
+		case AV_SAMPLE_FMT_S16P: spec.format = AUDIO_S16SYS; break;
+		case AV_SAMPLE_FMT_S32P: spec.format = AUDIO_S32SYS; break;
+		case AV_SAMPLE_FMT_FLTP: spec.format = AUDIO_F32SYS; break;
+		default:
+			fprintf(stderr, "unsupported audio format: %s\n", av_get_sample_fmt_name(avinfo.a_format));
+			return 1;
+		}
+		spec.channels = avinfo.a_n_channels;
+		spec.samples = 1024;
+		spec.callback = audio_callback;
+		spec.userdata = &avinfo;
+
+		audiodev = SDL_OpenAudioDevice(NULL, 0, &spec, &aspec, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+		assert(audiodev > 0);
+		SDL_PauseAudioDevice(audiodev, 0);
 	}
 
-	size_t video_frame = 0;
+	size_t video_frame = 0; // next frame to show
+	size_t shown_frame = SIZE_MAX; // frame currently on screen
 	bool force_redraw = false;
-	uint8_t *framebuf = malloc(avinfo.v_width * avinfo.v_height);
 
 	uint64_t debuginf_last_time = 0;
 	uint64_t fps_last_time = 0;
@@ -220,17 +351,40 @@ int main(void) {
 	size_t fps = 0;
 
 	bool paused = false;
-	bool stereogram = true;
-	int eyedist = 120;
-	int close_ratio_den = 8;
 	bool quit = false;
 	while (!quit) {
+		// Sleep until an event arrives or the next frame is due and
+		// rendered. Paused playback has no deadline, so only input or a
+		// frame rendered with changed parameters can wake us up then.
+		// Without a real-time sink, frames are due as soon as they are ready.
+		double audio_time = realtime ? get_audio_time(audiodev, &aspec, &avinfo, paused) : 0.0;
+		bool next_due = !realtime || video_frame < (size_t)(audio_time * avinfo.v_fps);
+		int timeout;
+		if ((force_redraw && render_ahead_ready(render_ahead, shown_frame)) || (next_due && render_ahead_ready(render_ahead, video_frame)))
+			timeout = 0;
+		else if (paused)
+			timeout = -1;
+		else if (next_due)
+			timeout = DEBUGINF_PERIOD;
+		else {
+			timeout = ceil(((double)(video_frame+1) / avinfo.v_fps - audio_time) * 1000.0);
+			if (timeout > DEBUGINF_PERIOD)
+				timeout = DEBUGINF_PERIOD;
+			else if (timeout < 0)
+				timeout = 0;
+		}
+
+		bool params_changed = false;
 		SDL_Event evt;
-		while (SDL_PollEvent(&evt) != 0) {
+		for (int have_evt = SDL_WaitEventTimeout(&evt, timeout); have_evt; have_evt = SDL_PollEvent(&evt)) {
 			switch (evt.type) {
 			case SDL_QUIT:
 				quit = true;
 				break;
+			case SDL_WINDOWEVENT:
+				if (evt.window.event == SDL_WINDOWEVENT_EXPOSED || evt.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+					force_redraw = true;
+				break;
 			case SDL_KEYDOWN:
 				switch (evt.key.keysym.sym) {
 					case SDLK_SPACE:
@@ -238,47 +392,84 @@ int main(void) {
 						break;
 					case SDLK_m:
 						stereogram = !stereogram;
-						force_redraw = true;
+						params_changed = true;
+						break;
+					case SDLK_i:
+						depth_params.invert = !depth_params.invert;
+						params_changed = true;
+						break;
+					case SDLK_p:
+						pattern = (pattern + 1) % n_patterns;
+						params_changed = true;
+						break;
+					case SDLK_r:
+						display_res = !display_res;
 						break;
 					case SDLK_RIGHT:
 						++eyedist;
-						force_redraw = true;
+						params_changed = true;
 						break;
 					case SDLK_LEFT:
 						if (eyedist-1 >= 10)
 							--eyedist;
-						force_redraw = true;
+						params_changed = true;
 						break;
 					case SDLK_UP:
 						if (close_ratio_den-1 >= 2)
 							--close_ratio_den;
-						force_redraw = true;
+						params_changed = true;
 						break;
 					case SDLK_DOWN:
 						++close_ratio_den;
-						force_redraw = true;
+						params_changed = true;
 						break;
 				}
 				break;
 			}
 		}
 
-		double audio_time = (double)atomic_load(&audio_pos) / (double)(aspec.freq * avinfo.a_n_channels * avinfo.a_sample_size);
-		size_t video_target_frame = audio_time * avinfo.v_fps;
+		// Follows window resizes.
+		int out_width, out_height;
+		get_output_size(sink, &avinfo, display_res, &out_width, &out_height);
+		if (out_width != params.out_width || out_height != params.out_height)
+			params_changed = true;
+
+		if (params_changed) {
+			params.stereogram = stereogram;
+			params.eyedist = eyedist;
+			params.close_ratio = 1.0/(double)close_ratio_den;
+			params.out_width = out_width;
+			params.out_height = out_height;
+			params.depth = depth_params;
+			params.pattern = patterns[pattern];
+			render_ahead_set_params(render_ahead, &params);
+			force_redraw = true;
+		}
+
+		size_t video_target_frame;
+		if (realtime) {
+			audio_time = get_audio_time(audiodev, &aspec, &avinfo, paused);
+			video_target_frame = audio_time * avinfo.v_fps;
+		} else {
+			audio_time = (double)video_frame / avinfo.v_fps;
+			video_target_frame = video_frame + 1;
+		}
 
 		uint64_t time_now = SDL_GetTicks64();
 		if (time_now - debuginf_last_time >= DEBUGINF_PERIOD) {
 			size_t bytes_per_sample = avinfo.a_n_channels * avinfo.a_sample_size;
-			printf(
-				"t=%lfs, fps=%llu, vid: %llu/%llu (%llu cached), aud: %llu (%llu cached), eyedist=%dpx, close=1/%d",
+			fprintf(
+				stderr,
+				"t=%lfs, fps=%llu, vid: %llu/%llu (%llu cached), aud: %llu (%llu cached), eyedist=%dpx, close=1/%d, res=%s",
 				audio_time,
 				fps,
 				video_frame, video_target_frame, atomic_load(&video_n_frames) - video_frame,
 				atomic_load(&audio_pos) / bytes_per_sample, (atomic_load(&audio_len) - atomic_load(&audio_pos)) / bytes_per_sample,
 				eyedist,
-				close_ratio_den
+				close_ratio_den,
+				display_res ? "output" : "video"
 			);
-			printf("     \r");
+			fprintf(stderr, "     \r");
 			debuginf_last_time = time_now;
 		}
 
@@ -288,48 +479,54 @@ int main(void) {
 			fps_last_time = time_now;
 		}
 
-		bool redraw = force_redraw;
-		force_redraw = false;
-		if (video_frame < video_target_frame) {
-			if (video_frame < atomic_load(&video_n_frames)) {
-				circ_buf_read(videobuf, framebuf, avinfo.v_width*avinfo.v_height);
-				redraw = true;
-			}
+		// When late, drop frames as long as the one after is ready too.
+		while (video_frame+1 < video_target_frame && render_ahead_ready(render_ahead, video_frame) && render_ahead_ready(render_ahead, video_frame+1)) {
 			++video_frame;
+			render_ahead_discard_before(render_ahead, video_frame);
 		}
 
-		if (redraw) {
-			if (stereogram) {
-				RNG_XoShiRo256ss rng_xoshiro = rng_xoshiro256ss(video_frame);
-				RNG *rng = (RNG*)&rng_xoshiro;
-				img_draw_autostereogram(pxdata, framebuf, avinfo.v_width, avinfo.v_height, eyedist, 1.0/(double)close_ratio_den, rng);
-			} else {
-				for (size_t y = 0; y < avinfo.v_height; ++y) {
-					for (size_t x = 0; x < avinfo.v_width; ++x) {
-						uint8_t val = framebuf[y*avinfo.v_width + x];
-						pxdata[y*avinfo.v_width + x] = rgba_to_u32(val, val, val, 255);
-					}
-				}
-			}
-			if (SDL_UpdateTexture(tex, NULL, pxdata, sizeof(uint32_t) * avinfo.v_width) != 0) {
-				printf("SDL_UpdateTexture failed: %s\n", SDL_GetError());
+		size_t present_frame = SIZE_MAX;
+		if (video_frame < video_target_frame && render_ahead_ready(render_ahead, video_frame))
+			present_frame = video_frame;
+		else if (force_redraw && render_ahead_ready(render_ahead, shown_frame))
+			present_frame = shown_frame;
+
+		const uint32_t *pxdata;
+		int px_width, px_height;
+		if (present_frame != SIZE_MAX && (pxdata = render_ahead_acquire(render_ahead, present_frame, &px_width, &px_height))) {
+			int ret = sink_present(sink, pxdata, px_width, px_height);
+			render_ahead_release(render_ahead, present_frame);
+			if (ret != 0)
 				return 1;
+			if (present_frame == video_frame) {
+				// Keep the shown frame around to re-render it if parameters change.
+				render_ahead_discard_before(render_ahead, video_frame);
+				shown_frame = video_frame++;
 			}
+			force_redraw = false;
+			++fps_acc;
+		} else if (!realtime && video_frame >= atomic_load(&video_n_frames)) {
+			if (atomic_load(&decode_done) && video_frame >= atomic_load(&video_n_frames))
+				quit = true;
 		}
-
-		++fps_acc;
-
-		SDL_RenderClear(rend);
-		SDL_RenderCopy(rend, tex, NULL, NULL);
-		SDL_RenderPresent(rend);
 	}
 
-	SDL_CloseAudioDevice(audiodev);
+	if (audiodev > 0)
+		SDL_CloseAudioDevice(audiodev);
+	// Stops the decoder, which may be blocked on a buffer nobody reads
+	// anymore and still calls into render_ahead.
+	circ_buf_close(videobuf);
+	circ_buf_close(audiobuf);
+	pthread_join(thread_decode_id, NULL);
+	// Joins the workers, which may still be reading from videobuf.
+	render_ahead_destroy(render_ahead);
 	circ_buf_destroy(videobuf);
 	circ_buf_destroy(audiobuf);
-	SDL_DestroyTexture(tex);
-	SDL_DestroyRenderer(rend);
-	SDL_DestroyWindow(win);
+	for (int i = 0; i < n_patterns; ++i) {
+		if (patterns[i])
+			pattern_tile_destroy(patterns[i]);
+	}
+	sink_destroy(sink);
 	SDL_Quit();
 	return 0;
 }
\ No newline at end of file
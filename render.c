@@ -0,0 +1,584 @@
+#include "render.h"
+
+#include <emmintrin.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t random_color_u32(RNG *rng) {
+	return (rng_u64(rng) & 0xFFFFFF00) | 0xFF;
+}
+
+PatternTile *pattern_tile_create(int width, int height) {
+	PatternTile *self = malloc(sizeof(PatternTile) + sizeof(uint32_t) * width * height);
+	if (!self) return NULL;
+	self->width = width;
+	self->height = height;
+	self->px = (uint32_t*)(self + 1);
+	return self;
+}
+
+PatternTile *pattern_tile_noise(int width, int height, uint64_t seed) {
+	PatternTile *self = pattern_tile_create(width, height);
+	if (!self) return NULL;
+	RNG_XoShiRo256ss rng_xoshiro = rng_xoshiro256ss(seed);
+	RNG *rng = (RNG*)&rng_xoshiro;
+	for (int i = 0; i < width * height; ++i)
+		self->px[i] = random_color_u32(rng);
+	return self;
+}
+
+void pattern_tile_destroy(PatternTile *self) {
+	free(self);
+}
+
+DepthParams depth_params_default(void) {
+	return (DepthParams){
+		.invert = false,
+		.gamma = 1.0,
+		.min = 0,
+		.max = 255,
+		.levels = 0,
+		.smooth = DEPTH_SMOOTH_NONE,
+		.smooth_radius = 1,
+	};
+}
+
+// Produces the depth map at the output size one row at a time. Source rows
+// are smoothed, bilinearly upscaled and remapped through a lookup table on
+// the fly, keeping only the few rows the filters need in memory. Without
+// any of these steps, rows are taken from the source directly.
+typedef struct {
+	const uint8_t *src;
+	int src_width;
+	int src_height;
+	int width;
+	int height;
+	uint8_t lut[256];
+	bool use_lut;
+	DepthSmooth smooth;
+	int radius;
+	int box_mul; // 65536 / (2*radius+1)
+	// Horizontally smoothed source rows, a ring of 2*radius+2 so the row
+	// leaving the box window is still there when the entering one is made
+	uint8_t *hrows;
+	int *hrow_y;
+	int n_hrows;
+	// Fully smoothed source rows, a ring of 2 for the two rows bilinear
+	// upscaling reads from
+	uint8_t *srows;
+	int srow_y[2];
+	// Box: per column sums of the horizontally smoothed rows around
+	// source row col_sum_y, slid down a row at a time
+	uint16_t *col_sum;
+	int col_sum_y;
+	// Box: scratch for the horizontal pass, see box_hrow()
+	uint8_t *ext;
+	uint16_t *prefix;
+	int *x0; // see scale_coord()
+	int *x1;
+	int *xw;
+	uint8_t *row; // NULL if rows are passed through from the source
+} DepthSampler;
+
+// Maps the center of output pixel i to a source coordinate in 1/256 pixels,
+// returned as the two neighbouring source pixels and the weight (0..255)
+// of the second one.
+static void scale_coord(int i, int n, int src_n, int *i0, int *i1, int *w) {
+	int pos = (int)(((2*(int64_t)i + 1) * src_n * 256) / (2*n)) - 128;
+	if (pos < 0)
+		pos = 0;
+	*i0 = pos >> 8;
+	*i1 = *i0+1 < src_n ? *i0+1 : *i0;
+	*w = pos & 0xFF;
+}
+
+static int clamp_int(int v, int lo, int hi) {
+	return v < lo ? lo : v > hi ? hi : v;
+}
+
+// Input range, gamma, quantization and inversion, in that order.
+static void build_depth_lut(uint8_t *lut, const DepthParams *params) {
+	double range = params->max > params->min ? params->max - params->min : 1;
+	for (int v = 0; v < 256; ++v) {
+		double d = (v - params->min) / range;
+		d = d < 0.0 ? 0.0 : d > 1.0 ? 1.0 : d;
+		if (params->gamma > 0.0 && params->gamma != 1.0)
+			d = pow(d, params->gamma);
+		if (params->levels >= 2)
+			d = round(d * (params->levels-1)) / (params->levels-1);
+		if (params->invert)
+			d = 1.0 - d;
+		lut[v] = round(d * 255.0);
+	}
+}
+
+// False if out of memory, the sampler must be freed either way.
+static bool depth_sampler_init(DepthSampler *self, const uint8_t *src, int src_width, int src_height, int width, int height, const DepthParams *params) {
+	*self = (DepthSampler){
+		.src = src,
+		.src_width = src_width,
+		.src_height = src_height,
+		.width = width,
+		.height = height,
+		.smooth = params->smooth,
+		.radius = params->smooth_radius < 1 ? 1 : params->smooth_radius,
+		.srow_y = { -1, -1 },
+		.col_sum_y = -1,
+	};
+
+	build_depth_lut(self->lut, params);
+	for (int v = 0; v < 256; ++v)
+		self->use_lut |= self->lut[v] != v;
+
+	if (self->smooth != DEPTH_SMOOTH_NONE) {
+		if (self->smooth == DEPTH_SMOOTH_MEDIAN && self->radius > DEPTH_MEDIAN_MAX_RADIUS)
+			self->radius = DEPTH_MEDIAN_MAX_RADIUS;
+		if (self->smooth == DEPTH_SMOOTH_BOX && self->radius > DEPTH_BOX_MAX_RADIUS)
+			self->radius = DEPTH_BOX_MAX_RADIUS;
+		// Bounds the row ring
+		if (self->radius > src_height)
+			self->radius = src_height;
+		int k = 2*self->radius + 1;
+		self->box_mul = (65536 + k/2) / k;
+		self->n_hrows = k + 1;
+		self->hrows = malloc((size_t)self->n_hrows * src_width);
+		self->hrow_y = malloc(sizeof(int) * self->n_hrows);
+		self->srows = malloc((size_t)2 * src_width);
+		if (self->smooth == DEPTH_SMOOTH_BOX) {
+			self->col_sum = malloc(sizeof(uint16_t) * src_width);
+			self->ext = malloc((size_t)src_width + 2*self->radius);
+			self->prefix = malloc(sizeof(uint16_t) * ((size_t)src_width + 2*self->radius + 1));
+			if (!self->col_sum || !self->ext || !self->prefix)
+				return false;
+		}
+		if (!self->hrows || !self->hrow_y || !self->srows)
+			return false;
+		for (int i = 0; i < self->n_hrows; ++i)
+			self->hrow_y[i] = -1;
+	}
+
+	bool scale = width != src_width || height != src_height;
+	if (scale) {
+		self->x0 = malloc(sizeof(int) * width);
+		self->x1 = malloc(sizeof(int) * width);
+		self->xw = malloc(sizeof(int) * width);
+		if (!self->x0 || !self->x1 || !self->xw)
+			return false;
+		for (int x = 0; x < width; ++x)
+			scale_coord(x, width, src_width, &self->x0[x], &self->x1[x], &self->xw[x]);
+	}
+	if (scale || self->use_lut) {
+		self->row = malloc(width);
+		if (!self->row)
+			return false;
+	}
+	return true;
+}
+
+static void depth_sampler_free(DepthSampler *self) {
+	free(self->hrows);
+	free(self->hrow_y);
+	free(self->srows);
+	free(self->col_sum);
+	free(self->ext);
+	free(self->prefix);
+	free(self->x0);
+	free(self->x1);
+	free(self->xw);
+	free(self->row);
+}
+
+static uint8_t median3_u8(uint8_t a, uint8_t b, uint8_t c) {
+	uint8_t lo = a < b ? a : b;
+	uint8_t hi = a < b ? b : a;
+	uint8_t m = hi < c ? hi : c;
+	return lo > m ? lo : m;
+}
+
+// Row loops of the smoothing passes, 16 pixels at a time.
+static void median3_row(uint8_t *restrict out, const uint8_t *restrict a, const uint8_t *restrict b, const uint8_t *restrict c, int n) {
+	int x = 0;
+	for (; x+16 <= n; x += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a+x));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b+x));
+		__m128i vc = _mm_loadu_si128((const __m128i*)(c+x));
+		__m128i lo = _mm_min_epu8(va, vb);
+		__m128i hi = _mm_max_epu8(va, vb);
+		_mm_storeu_si128((__m128i*)(out+x), _mm_max_epu8(lo, _mm_min_epu8(hi, vc)));
+	}
+	for (; x < n; ++x)
+		out[x] = median3_u8(a[x], b[x], c[x]);
+}
+
+static void sum_add_row(uint16_t *restrict sum, const uint8_t *restrict in, int n) {
+	__m128i zero = _mm_setzero_si128();
+	int x = 0;
+	for (; x+16 <= n; x += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(in+x));
+		__m128i s0 = _mm_loadu_si128((const __m128i*)(sum+x));
+		__m128i s1 = _mm_loadu_si128((const __m128i*)(sum+x+8));
+		_mm_storeu_si128((__m128i*)(sum+x), _mm_add_epi16(s0, _mm_unpacklo_epi8(v, zero)));
+		_mm_storeu_si128((__m128i*)(sum+x+8), _mm_add_epi16(s1, _mm_unpackhi_epi8(v, zero)));
+	}
+	for (; x < n; ++x)
+		sum[x] += in[x];
+}
+
+// (sum * mul + (1 << 15)) >> 16 for 16 bit sums: the high half, plus one
+// if the low half rounds it up.
+static __m128i box_mean_epu16(__m128i sum, __m128i mul) {
+	return _mm_add_epi16(_mm_mulhi_epu16(sum, mul), _mm_srli_epi16(_mm_mullo_epi16(sum, mul), 15));
+}
+
+static void box_mean_row(uint8_t *restrict out, const uint16_t *restrict sum, int n, int mul) {
+	__m128i vmul = _mm_set1_epi16(mul);
+	int x = 0;
+	for (; x+16 <= n; x += 16) {
+		__m128i m0 = box_mean_epu16(_mm_loadu_si128((const __m128i*)(sum+x)), vmul);
+		__m128i m1 = box_mean_epu16(_mm_loadu_si128((const __m128i*)(sum+x+8)), vmul);
+		_mm_storeu_si128((__m128i*)(out+x), _mm_packus_epi16(m0, m1));
+	}
+	for (; x < n; ++x)
+		out[x] = (sum[x] * mul + (1 << 15)) >> 16;
+}
+
+// Horizontal box of radius r over in, edges extended. Sums come from
+// prefix sums, which wrap at 16 bits but stay exact in differences of
+// at most 2*r+1 <= 2*DEPTH_BOX_MAX_RADIUS+1 bytes.
+static void box_hrow(uint8_t *restrict out, const uint8_t *restrict in, int w, int r, int mul, uint8_t *restrict ext, uint16_t *restrict prefix) {
+	int k = 2*r + 1, n = w + 2*r;
+	memset(ext, in[0], r);
+	memcpy(ext + r, in, w);
+	memset(ext + r + w, in[w-1], r);
+
+	__m128i zero = _mm_setzero_si128();
+	__m128i carry = zero;
+	prefix[0] = 0;
+	int i = 0;
+	for (; i+8 <= n; i += 8) {
+		__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(ext+i)), zero);
+		v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+		v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi16(v, carry);
+		_mm_storeu_si128((__m128i*)(prefix+i+1), v);
+		carry = _mm_shuffle_epi32(_mm_shufflehi_epi16(v, 0xFF), 0xFF);
+	}
+	for (; i < n; ++i)
+		prefix[i+1] = prefix[i] + ext[i];
+
+	__m128i vmul = _mm_set1_epi16(mul);
+	int x = 0;
+	for (; x+16 <= w; x += 16) {
+		__m128i s0 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(prefix+x+k)), _mm_loadu_si128((const __m128i*)(prefix+x)));
+		__m128i s1 = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(prefix+x+k+8)), _mm_loadu_si128((const __m128i*)(prefix+x+8)));
+		_mm_storeu_si128((__m128i*)(out+x), _mm_packus_epi16(box_mean_epu16(s0, vmul), box_mean_epu16(s1, vmul)));
+	}
+	for (; x < w; ++x) {
+		uint16_t sum = prefix[x+k] - prefix[x];
+		out[x] = (sum * mul + (1 << 15)) >> 16;
+	}
+}
+
+// Slides column sums down a row and writes their means.
+static void box_slide_row(uint8_t *restrict out, uint16_t *restrict sum, const uint8_t *restrict add, const uint8_t *restrict sub, int n, int mul) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i vmul = _mm_set1_epi16(mul);
+	int x = 0;
+	for (; x+16 <= n; x += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(add+x));
+		__m128i vs = _mm_loadu_si128((const __m128i*)(sub+x));
+		__m128i s0 = _mm_loadu_si128((const __m128i*)(sum+x));
+		__m128i s1 = _mm_loadu_si128((const __m128i*)(sum+x+8));
+		s0 = _mm_sub_epi16(_mm_add_epi16(s0, _mm_unpacklo_epi8(va, zero)), _mm_unpacklo_epi8(vs, zero));
+		s1 = _mm_sub_epi16(_mm_add_epi16(s1, _mm_unpackhi_epi8(va, zero)), _mm_unpackhi_epi8(vs, zero));
+		_mm_storeu_si128((__m128i*)(sum+x), s0);
+		_mm_storeu_si128((__m128i*)(sum+x+8), s1);
+		_mm_storeu_si128((__m128i*)(out+x), _mm_packus_epi16(box_mean_epu16(s0, vmul), box_mean_epu16(s1, vmul)));
+	}
+	for (; x < n; ++x) {
+		sum[x] = sum[x] + add[x] - sub[x];
+		out[x] = (sum[x] * mul + (1 << 15)) >> 16;
+	}
+}
+
+// Source row sy after horizontal smoothing, cached in a ring.
+static const uint8_t *depth_sampler_hrow(DepthSampler *self, int sy) {
+	int r = self->radius, w = self->src_width;
+	int slot = sy % self->n_hrows;
+	uint8_t *out = self->hrows + (size_t)slot * w;
+	if (self->hrow_y[slot] == sy)
+		return out;
+	self->hrow_y[slot] = sy;
+
+	const uint8_t *in = self->src + (size_t)sy * w;
+	if (self->smooth == DEPTH_SMOOTH_BOX) {
+		box_hrow(out, in, w, r, self->box_mul, self->ext, self->prefix);
+	} else {
+		// Median of 3, the only median radius
+		out[0] = median3_u8(in[0], in[0], in[w > 1]);
+		if (w > 2)
+			median3_row(out + 1, in, in + 1, in + 2, w-2);
+		if (w > 1)
+			out[w-1] = median3_u8(in[w-2], in[w-1], in[w-1]);
+	}
+	return out;
+}
+
+// Source row sy after smoothing.
+static const uint8_t *depth_sampler_srow(DepthSampler *self, int sy) {
+	if (self->smooth == DEPTH_SMOOTH_NONE)
+		return self->src + (size_t)sy * self->src_width;
+	int r = self->radius, w = self->src_width;
+	uint8_t *out = self->srows + (size_t)(sy & 1) * w;
+	if (self->srow_y[sy & 1] == sy)
+		return out;
+	self->srow_y[sy & 1] = sy;
+
+	int h = self->src_height;
+	if (self->smooth == DEPTH_SMOOTH_BOX) {
+		uint16_t *sum = self->col_sum;
+		if (self->col_sum_y >= 0 && sy == self->col_sum_y + 1) {
+			const uint8_t *leaving = depth_sampler_hrow(self, clamp_int(sy-1-r, 0, h-1));
+			const uint8_t *entering = depth_sampler_hrow(self, clamp_int(sy+r, 0, h-1));
+			box_slide_row(out, sum, entering, leaving, w, self->box_mul);
+		} else {
+			for (int x = 0; x < w; ++x)
+				sum[x] = 0;
+			for (int i = -r; i <= r; ++i)
+				sum_add_row(sum, depth_sampler_hrow(self, clamp_int(sy+i, 0, h-1)), w);
+			box_mean_row(out, sum, w, self->box_mul);
+		}
+		self->col_sum_y = sy;
+	} else {
+		const uint8_t *a = depth_sampler_hrow(self, clamp_int(sy-1, 0, h-1));
+		const uint8_t *b = depth_sampler_hrow(self, sy);
+		const uint8_t *c = depth_sampler_hrow(self, clamp_int(sy+1, 0, h-1));
+		median3_row(out, a, b, c, w);
+	}
+	return out;
+}
+
+static const uint8_t *depth_sampler_row(DepthSampler *self, int y) {
+	if (!self->row)
+		return depth_sampler_srow(self, y);
+	if (!self->x0) {
+		const uint8_t *in = depth_sampler_srow(self, y);
+		for (int x = 0; x < self->width; ++x)
+			self->row[x] = self->lut[in[x]];
+		return self->row;
+	}
+	int y0, y1, yw;
+	scale_coord(y, self->height, self->src_height, &y0, &y1, &yw);
+	const uint8_t *r0 = depth_sampler_srow(self, y0);
+	const uint8_t *r1 = depth_sampler_srow(self, y1);
+	for (int x = 0; x < self->width; ++x) {
+		int a = self->x0[x], b = self->x1[x], w = self->xw[x];
+		int top = r0[a]*(256-w) + r0[b]*w;
+		int bot = r1[a]*(256-w) + r1[b]*w;
+		self->row[x] = self->lut[(top*(256-yw) + bot*yw + 32768) >> 16];
+	}
+	return self->row;
+}
+
+// Everything in the stereogram kernel that only depends on the depth value
+// (0..255), so rows can be processed without floating point math.
+typedef struct {
+	int sep[256]; // distance between the two pixels that have to match
+	// A point is hidden if a neighbour t = 1, 2, ... pixels away isn't below
+	// zt[depth][t-1]. Each list ends with -1 after the first threshold at or
+	// beyond the far plane.
+	int *zt[256];
+	int max_t; // length of the longest list
+	int *buf;
+} StereoTables;
+
+// Depth (0..1) a neighbour t pixels away must stay below, computed exactly
+// like the original floating point kernel so tables give identical results.
+static double stereo_zt(int depth, int t, int eyedist, double close_ratio) {
+	double val = (double)depth / 255.0;
+	return val + 2*(2-close_ratio*val)*t/(close_ratio*eyedist);
+}
+
+// Smallest integer depth v with v/255.0 >= zt, so that for integer depths
+// depth < v <=> depth/255.0 < zt.
+static int stereo_threshold(double zt) {
+	// Every depth is below, also for zt that overflow or aren't finite
+	if (!(zt <= 1.0))
+		return 256;
+	int v = ceil(zt * 255.0);
+	while (v > 0 && (double)(v-1) / 255.0 >= zt)
+		--v;
+	while ((double)v / 255.0 < zt)
+		++v;
+	return v;
+}
+
+static bool stereo_tables_init(StereoTables *self, int eyedist, double close_ratio) {
+	int len[256];
+	size_t total = 0;
+	self->max_t = 0;
+	for (int d = 0; d < 256; ++d) {
+		len[d] = 1;
+		while (stereo_zt(d, len[d], eyedist, close_ratio) < 1)
+			++len[d];
+		if (len[d] > self->max_t)
+			self->max_t = len[d];
+		total += len[d] + 1;
+	}
+
+	self->buf = malloc(sizeof(int) * total);
+	if (!self->buf)
+		return false;
+	int *p = self->buf;
+	for (int d = 0; d < 256; ++d) {
+		double val = (double)d / 255.0;
+		self->sep[d] = round((1-close_ratio*val)*eyedist/(2-close_ratio*val));
+		self->zt[d] = p;
+		for (int t = 1; t <= len[d]; ++t)
+			*p++ = stereo_threshold(stereo_zt(d, t, eyedist, close_ratio));
+		*p++ = -1;
+	}
+	return true;
+}
+
+// out[x] = max(in[x-r..x+r]) for r <= x < n-r, in O(n) independent of r
+// (van Herk/Gil-Werman). g and h are scratch rows of length n.
+static void row_window_max(uint8_t *out, const uint8_t *in, int n, int r, uint8_t *g, uint8_t *h) {
+	int k = 2*r + 1;
+	for (int i = 0; i < n; ++i)
+		g[i] = (i % k == 0 || in[i] > g[i-1]) ? in[i] : g[i-1];
+	for (int i = n-1; i >= 0; --i)
+		h[i] = (i % k == k-1 || i == n-1 || in[i] > h[i+1]) ? in[i] : h[i+1];
+	for (int x = r; x < n-r; ++x)
+		out[x] = h[x-r] > g[x+r] ? h[x-r] : g[x+r];
+}
+
+int img_draw_autostereogram(uint32_t *dst, int width, int height, const uint8_t *src, int src_width, int src_height, const DepthParams *depth_params, int eyedist /*in output pixels*/, double close_ratio, const PatternTile *tile, RNG *rng) {
+	StereoTables tab;
+	if (!stereo_tables_init(&tab, eyedist, close_ratio))
+		return -1;
+	// Most points have no neighbour within max_t pixels that comes anywhere
+	// near hiding them, which the window maximum tells without walking
+	// through the neighbours one by one.
+	int r = tab.max_t;
+	bool use_window_max = 2*r + 1 <= width;
+
+	DepthSampler depth_sampler;
+	bool ok = depth_sampler_init(&depth_sampler, src, src_width, src_height, width, height, depth_params);
+	int *same = malloc(sizeof(int) * width);
+	uint8_t *near_max = malloc((size_t)width * 3);
+	if (!ok || !same || !near_max) {
+		free(near_max);
+		free(same);
+		depth_sampler_free(&depth_sampler);
+		free(tab.buf);
+		return -1;
+	}
+	for (int y = 0; y < height; ++y) {
+		const uint8_t *depth = depth_sampler_row(&depth_sampler, y);
+		uint32_t *pix = dst + y*width;
+
+		if (use_window_max)
+			row_window_max(near_max, depth, width, r, near_max + width, near_max + 2*width);
+
+		for (int x = 0; x < width; ++x)
+			same[x] = x;
+
+		for (int x = 0; x < width; ++x) {
+			int val = depth[x];
+			int s = tab.sep[val];
+			int left = x - s/2;
+			int right = left + s;
+			if (left < 0 || right >= width)
+				continue;
+			bool visible = false;
+			const int *zt = tab.zt[val];
+
+			if (use_window_max && x-r >= 0 && x+r < width && near_max[x] < zt[0]) {
+				visible = true;
+			} else {
+				int t = 1;
+				do {
+					if (x-t < 0 || x+t >= width)
+						break;
+					visible = depth[x-t] < *zt && depth[x+t] < *zt;
+					++t;
+					++zt;
+				} while (visible && *zt >= 0);
+			}
+			if (visible) {
+				int l = same[left];
+				while (l != left && l != right) {
+					if (l < right) {
+						left = l;
+						l = same[left];
+					} else {
+						same[left] = right;
+						left = right;
+						l = same[left];
+						right = l;
+					}
+				}
+				same[left] = right;
+			}
+		}
+		if (tile) {
+			// Free pixels take the tile's pixel, walking its row backwards
+			// along with x.
+			const uint32_t *strip = tile->px + (size_t)(y % tile->height) * tile->width;
+			int col = (width-1) % tile->width;
+			for (int x = width-1; x >= 0; --x) {
+				pix[x] = same[x] == x ? strip[col] : pix[same[x]];
+				if (--col < 0)
+					col = tile->width - 1;
+			}
+		} else {
+			for (int x = width-1; x >= 0; --x) {
+				if (same[x] == x) pix[x] = rng_bool(rng, 0.5) ? rgba_to_u32(255, 255, 255, 255) : rgba_to_u32(0, 0, 0, 255);
+				else pix[x] = pix[same[x]];
+			}
+		}
+	}
+	free(near_max);
+	free(same);
+	depth_sampler_free(&depth_sampler);
+	free(tab.buf);
+	return 0;
+}
+
+void render_output_size(const RenderParams *params, int src_width, int src_height, int *width, int *height) {
+	if (params->out_width > 0 && params->out_height > 0) {
+		*width = params->out_width;
+		*height = params->out_height;
+	} else {
+		*width = src_width;
+		*height = src_height;
+	}
+}
+
+int render_frame(uint32_t *dst, int width, int height, const uint8_t *src, int src_width, int src_height, const RenderParams *params, size_t frame) {
+	if (params->stereogram) {
+		RNG_XoShiRo256ss rng_xoshiro = rng_xoshiro256ss(frame);
+		RNG *rng = (RNG*)&rng_xoshiro;
+		int eyedist = round((double)params->eyedist * width / src_width);
+		// Tiny outputs would round it down to 0
+		if (eyedist < 1)
+			eyedist = 1;
+		return img_draw_autostereogram(dst, width, height, src, src_width, src_height, &params->depth, eyedist, params->close_ratio, params->pattern, rng);
+	} else {
+		DepthSampler depth_sampler;
+		if (!depth_sampler_init(&depth_sampler, src, src_width, src_height, width, height, &params->depth)) {
+			depth_sampler_free(&depth_sampler);
+			return -1;
+		}
+		for (int y = 0; y < height; ++y) {
+			const uint8_t *row = depth_sampler_row(&depth_sampler, y);
+			for (int x = 0; x < width; ++x)
+				dst[y*width + x] = rgba_to_u32(row[x], row[x], row[x], 255);
+		}
+		depth_sampler_free(&depth_sampler);
+		return 0;
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rng.h"
+
+#define DEPTH_MEDIAN_MAX_RADIUS 1
+// Box sums of 2*radius+1 rows fit 16 bits
+#define DEPTH_BOX_MAX_RADIUS 128
+
+typedef enum {
+	DEPTH_SMOOTH_NONE,
+	DEPTH_SMOOTH_BOX,
+	DEPTH_SMOOTH_MEDIAN,
+} DepthSmooth;
+
+// Turns luma into depth. Done row by row inside the render pass, not as
+// separate passes over the frame.
+typedef struct DepthParams {
+	bool invert;
+	double gamma;
+	// Luma range stretched to the full depth range, clamped outside
+	uint8_t min;
+	uint8_t max;
+	int levels; // quantize to this many depth steps, 0 for off
+	// Separable smoothing of the source against compression noise
+	DepthSmooth smooth;
+	int smooth_radius; // at most DEPTH_BOX_MAX_RADIUS / DEPTH_MEDIAN_MAX_RADIUS
+} DepthParams;
+
+// Image that stereogram pixels are filled with. Pixels are RGBA (see
+// rgba_to_u32()), each row one contiguous strip, so filling a row reads a
+// single strip front to back.
+typedef struct PatternTile {
+	int width;
+	int height;
+	uint32_t *px;
+} PatternTile;
+
+typedef struct RenderParams {
+	bool stereogram; // false: plain grayscale
+	int eyedist; // in source pixels
+	double close_ratio;
+	// Size to render at, 0 for the source size. The depth map is upscaled
+	// while rendering, so dots stay one output pixel in size.
+	int out_width;
+	int out_height;
+	DepthParams depth;
+	// Not owned, must outlive any rendering with these params.
+	// NULL for random black and white dots.
+	const PatternTile *pattern;
+} RenderParams;
+
+static inline uint32_t rgba_to_u32(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+	return r << 24 | g << 16 | b << 8 | a;
+}
+
+// Uninitialized pixels.
+PatternTile *pattern_tile_create(int width, int height);
+// Random colors, the same for the same seed.
+PatternTile *pattern_tile_noise(int width, int height, uint64_t seed);
+void pattern_tile_destroy(PatternTile *self);
+
+// Linear depth, no smoothing.
+DepthParams depth_params_default(void);
+
+// Draws a width x height stereogram of the depth map src, which is
+// preprocessed per depth_params and bilinearly scaled to the output size
+// if needed. Pixels come from tile, or are random dots from rng if it is NULL.
+// Returns 0 on success, -1 if out of memory.
+int img_draw_autostereogram(uint32_t *dst, int width, int height, const uint8_t *src, int src_width, int src_height, const DepthParams *depth_params, int eyedist /*in output pixels*/, double close_ratio, const PatternTile *tile, RNG *rng);
+
+// Size of frames rendered with params.
+void render_output_size(const RenderParams *params, int src_width, int src_height, int *width, int *height);
+
+// Renders the luma frame src into dst (RGBA, see render_output_size()).
+// Stereogram dots are seeded with the frame number, so rendering a frame
+// again gives the same pattern. Returns 0 on success, -1 if out of memory.
+int render_frame(uint32_t *dst, int width, int height, const uint8_t *src, int src_width, int src_height, const RenderParams *params, size_t frame);
+
+#endif // __RENDER_H__
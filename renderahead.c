@@ -0,0 +1,229 @@
+#include "renderahead.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+static RenderAheadSlot *slot_of(RenderAhead *self, size_t frame) {
+	return &self->slots[frame % self->n_slots];
+}
+
+static bool slot_has(RenderAheadSlot *slot, size_t frame) {
+	return slot->state != RENDER_AHEAD_SLOT_EMPTY && slot->frame == frame;
+}
+
+// Returns the oldest slot that has to be (re-)rendered, or NULL.
+static RenderAheadSlot *find_render_job(RenderAhead *self) {
+	for (size_t f = self->base; f < self->next_fetch; ++f) {
+		RenderAheadSlot *slot = slot_of(self, f);
+		if (!slot_has(slot, f) || slot->discard)
+			continue;
+		if (slot->state == RENDER_AHEAD_SLOT_LOADED)
+			return slot;
+		if (slot->state == RENDER_AHEAD_SLOT_READY && slot->gen != self->gen && !slot->pinned)
+			return slot;
+	}
+	return NULL;
+}
+
+// Returns the slot for the next frame in the video buffer if it can be read now, or NULL.
+static RenderAheadSlot *find_fetch_job(RenderAhead *self) {
+	if (self->fetching || self->next_fetch >= self->n_decoded || self->next_fetch >= self->base + self->n_slots)
+		return NULL;
+	RenderAheadSlot *slot = slot_of(self, self->next_fetch);
+	return slot->state == RENDER_AHEAD_SLOT_EMPTY ? slot : NULL;
+}
+
+static void *thread_worker(void *vargp) {
+	RenderAhead *self = (RenderAhead*)vargp;
+	pthread_mutex_lock(&self->lock);
+	while (!self->quit) {
+		RenderAheadSlot *slot;
+		if ((slot = find_render_job(self))) {
+			RenderParams params = self->params;
+			uint64_t gen = self->gen;
+			slot->state = RENDER_AHEAD_SLOT_RENDERING;
+			pthread_mutex_unlock(&self->lock);
+
+			int width, height;
+			render_output_size(&params, self->width, self->height, &width, &height);
+			if ((size_t)width * height > slot->px_cap) {
+				free(slot->px);
+				slot->px_cap = (size_t)width * height;
+				slot->px = malloc(sizeof(uint32_t) * slot->px_cap);
+				assert(slot->px);
+			}
+			slot->px_width = width;
+			slot->px_height = height;
+			int ret = render_frame(slot->px, width, height, slot->luma, self->width, self->height, &params, slot->frame);
+			assert(ret == 0);
+
+			pthread_mutex_lock(&self->lock);
+			if (slot->discard) {
+				slot->discard = false;
+				slot->state = RENDER_AHEAD_SLOT_EMPTY;
+				pthread_cond_broadcast(&self->cond);
+				continue;
+			}
+			slot->state = RENDER_AHEAD_SLOT_READY;
+			slot->gen = gen;
+			if (gen == self->gen && self->on_ready) {
+				pthread_mutex_unlock(&self->lock);
+				self->on_ready(self->userdata);
+				pthread_mutex_lock(&self->lock);
+			}
+		} else if ((slot = find_fetch_job(self))) {
+			// Frames have to be read in order, so only one worker reads at a time.
+			slot->state = RENDER_AHEAD_SLOT_LOADING;
+			slot->frame = self->next_fetch++;
+			self->fetching = true;
+			pthread_mutex_unlock(&self->lock);
+
+			circ_buf_read(self->src, slot->luma, (size_t)self->width * self->height);
+
+			pthread_mutex_lock(&self->lock);
+			self->fetching = false;
+			if (slot->discard) {
+				slot->discard = false;
+				slot->state = RENDER_AHEAD_SLOT_EMPTY;
+			} else
+				slot->state = RENDER_AHEAD_SLOT_LOADED;
+			pthread_cond_broadcast(&self->cond);
+		} else
+			pthread_cond_wait(&self->cond, &self->lock);
+	}
+	pthread_mutex_unlock(&self->lock);
+	return NULL;
+}
+
+RenderAhead *render_ahead_create(CircBuf *src, int width, int height, const RenderParams *params, int n_slots, int n_workers, void (*on_ready)(void *userdata), void *userdata) {
+	RenderAhead *self = malloc(sizeof(RenderAhead));
+	if (!self) return NULL;
+	*self = (RenderAhead){
+		.src = src,
+		.width = width,
+		.height = height,
+		.params = *params,
+		.on_ready = on_ready,
+		.userdata = userdata,
+		.n_slots = n_slots,
+		.n_workers = 0,
+	};
+	int ret;
+	ret = pthread_mutex_init(&self->lock, NULL);
+	assert(ret == 0);
+	ret = pthread_cond_init(&self->cond, NULL);
+	assert(ret == 0);
+
+	self->slots = calloc(n_slots, sizeof(RenderAheadSlot));
+	self->workers = calloc(n_workers, sizeof(pthread_t));
+	if (!self->slots || !self->workers) {
+		render_ahead_destroy(self);
+		return NULL;
+	}
+	for (int i = 0; i < n_slots; ++i) {
+		self->slots[i].luma = malloc((size_t)width * height);
+		if (!self->slots[i].luma) {
+			render_ahead_destroy(self);
+			return NULL;
+		}
+	}
+	for (int i = 0; i < n_workers; ++i) {
+		if (pthread_create(&self->workers[i], NULL, thread_worker, self) != 0) {
+			render_ahead_destroy(self);
+			return NULL;
+		}
+		++self->n_workers;
+	}
+	return self;
+}
+
+void render_ahead_destroy(RenderAhead *self) {
+	pthread_mutex_lock(&self->lock);
+	self->quit = true;
+	pthread_cond_broadcast(&self->cond);
+	pthread_mutex_unlock(&self->lock);
+	for (int i = 0; i < self->n_workers; ++i)
+		pthread_join(self->workers[i], NULL);
+
+	if (self->slots) {
+		for (int i = 0; i < self->n_slots; ++i) {
+			free(self->slots[i].luma);
+			free(self->slots[i].px);
+		}
+	}
+	free(self->slots);
+	free(self->workers);
+	pthread_cond_destroy(&self->cond);
+	pthread_mutex_destroy(&self->lock);
+	free(self);
+}
+
+void render_ahead_frame_decoded(RenderAhead *self) {
+	pthread_mutex_lock(&self->lock);
+	++self->n_decoded;
+	pthread_cond_broadcast(&self->cond);
+	pthread_mutex_unlock(&self->lock);
+}
+
+void render_ahead_set_params(RenderAhead *self, const RenderParams *params) {
+	pthread_mutex_lock(&self->lock);
+	self->params = *params;
+	++self->gen;
+	pthread_cond_broadcast(&self->cond);
+	pthread_mutex_unlock(&self->lock);
+}
+
+static bool is_ready(RenderAhead *self, size_t frame) {
+	RenderAheadSlot *slot = slot_of(self, frame);
+	return slot_has(slot, frame) && slot->state == RENDER_AHEAD_SLOT_READY && slot->gen == self->gen;
+}
+
+bool render_ahead_ready(RenderAhead *self, size_t frame) {
+	pthread_mutex_lock(&self->lock);
+	bool ready = is_ready(self, frame);
+	pthread_mutex_unlock(&self->lock);
+	return ready;
+}
+
+const uint32_t *render_ahead_acquire(RenderAhead *self, size_t frame, int *width, int *height) {
+	const uint32_t *px = NULL;
+	pthread_mutex_lock(&self->lock);
+	if (is_ready(self, frame)) {
+		RenderAheadSlot *slot = slot_of(self, frame);
+		slot->pinned = true;
+		px = slot->px;
+		*width = slot->px_width;
+		*height = slot->px_height;
+	}
+	pthread_mutex_unlock(&self->lock);
+	return px;
+}
+
+void render_ahead_release(RenderAhead *self, size_t frame) {
+	pthread_mutex_lock(&self->lock);
+	RenderAheadSlot *slot = slot_of(self, frame);
+	assert(slot_has(slot, frame) && slot->pinned);
+	slot->pinned = false;
+	// Parameters may have changed in the meantime.
+	pthread_cond_broadcast(&self->cond);
+	pthread_mutex_unlock(&self->lock);
+}
+
+void render_ahead_discard_before(RenderAhead *self, size_t frame) {
+	pthread_mutex_lock(&self->lock);
+	for (size_t f = self->base; f < frame && f < self->next_fetch; ++f) {
+		RenderAheadSlot *slot = slot_of(self, f);
+		if (!slot_has(slot, f))
+			continue;
+		assert(!slot->pinned);
+		// Slots in use by a worker are freed once it's done with them.
+		if (slot->state == RENDER_AHEAD_SLOT_LOADING || slot->state == RENDER_AHEAD_SLOT_RENDERING)
+			slot->discard = true;
+		else
+			slot->state = RENDER_AHEAD_SLOT_EMPTY;
+	}
+	if (frame > self->base)
+		self->base = frame;
+	pthread_cond_broadcast(&self->cond);
+	pthread_mutex_unlock(&self->lock);
+}
@@ -0,0 +1,77 @@
+#ifndef __RENDERAHEAD_H__
+#define __RENDERAHEAD_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "circbuf.h"
+#include "render.h"
+
+// Renders upcoming frames on worker threads, so the presenting thread only
+// has to pick up finished pixels when a frame becomes due.
+//
+// Workers read luma frames from the video buffer in order into a ring of
+// slots (slot = frame % n_slots) and render them with the current
+// RenderParams. Changing the parameters invalidates all rendered slots,
+// which then get rendered again from the luma they keep.
+
+typedef enum {
+	RENDER_AHEAD_SLOT_EMPTY,
+	RENDER_AHEAD_SLOT_LOADING, // luma being read from the video buffer
+	RENDER_AHEAD_SLOT_LOADED, // luma available, not rendered yet
+	RENDER_AHEAD_SLOT_RENDERING,
+	RENDER_AHEAD_SLOT_READY,
+} RenderAheadSlotState;
+
+typedef struct RenderAheadSlot {
+	RenderAheadSlotState state;
+	size_t frame;
+	uint64_t gen; // params generation px was rendered with
+	bool pinned; // px is being read by the presenter
+	bool discard; // frame was discarded while rendering
+	uint8_t *luma;
+	uint32_t *px;
+	int px_width;
+	int px_height;
+	size_t px_cap; // in pixels
+} RenderAheadSlot;
+
+typedef struct RenderAhead {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	CircBuf *src;
+	int width;
+	int height;
+	RenderParams params;
+	uint64_t gen;
+	size_t n_decoded; // frames available in src
+	size_t next_fetch; // next frame to read from src
+	bool fetching;
+	size_t base; // oldest frame still needed
+	bool quit;
+	void (*on_ready)(void *userdata);
+	void *userdata;
+	int n_slots;
+	RenderAheadSlot *slots;
+	int n_workers;
+	pthread_t *workers;
+} RenderAhead;
+
+// on_ready is called from a worker thread whenever a frame finished
+// rendering with the current parameters.
+RenderAhead *render_ahead_create(CircBuf *src, int width, int height, const RenderParams *params, int n_slots, int n_workers, void (*on_ready)(void *userdata), void *userdata);
+void render_ahead_destroy(RenderAhead *self);
+// Call once for every frame written to src.
+void render_ahead_frame_decoded(RenderAhead *self);
+void render_ahead_set_params(RenderAhead *self, const RenderParams *params);
+// Whether frame is rendered with the current parameters.
+bool render_ahead_ready(RenderAhead *self, size_t frame);
+// Returns the pixels of frame if it is ready, NULL otherwise. The pixels
+// stay valid and unchanged until render_ahead_release().
+const uint32_t *render_ahead_acquire(RenderAhead *self, size_t frame, int *width, int *height);
+void render_ahead_release(RenderAhead *self, size_t frame);
+// Frames before frame are no longer needed, their slots get reused.
+void render_ahead_discard_before(RenderAhead *self, size_t frame);
+
+#endif // __RENDERAHEAD_H__
@@ -0,0 +1,237 @@
+#include "sink.h"
+
+#include <SDL2/SDL.h>
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+typedef struct {
+	Sink base;
+	SDL_Window *win;
+	SDL_Renderer *rend;
+	SDL_Texture *tex;
+	int tex_width;
+	int tex_height;
+} SinkSDL;
+
+static bool sink_sdl_get_size(void *_self, int *width, int *height) {
+	SinkSDL *self = _self;
+	return SDL_GetRendererOutputSize(self->rend, width, height) == 0;
+}
+
+static int sink_sdl_present(void *_self, const uint32_t *pxdata, int width, int height) {
+	SinkSDL *self = _self;
+	if (!self->tex || self->tex_width != width || self->tex_height != height) {
+		if (self->tex)
+			SDL_DestroyTexture(self->tex);
+		self->tex = SDL_CreateTexture(self->rend, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, width, height);
+		if (!self->tex) {
+			printf("SDL_CreateTexture failed: %s\n", SDL_GetError());
+			return -1;
+		}
+		self->tex_width = width;
+		self->tex_height = height;
+	}
+	if (SDL_UpdateTexture(self->tex, NULL, pxdata, sizeof(uint32_t) * width) != 0) {
+		printf("SDL_UpdateTexture failed: %s\n", SDL_GetError());
+		return -1;
+	}
+	SDL_RenderClear(self->rend);
+	SDL_RenderCopy(self->rend, self->tex, NULL, NULL);
+	SDL_RenderPresent(self->rend);
+	return 0;
+}
+
+static void sink_sdl_destroy(void *_self) {
+	SinkSDL *self = _self;
+	if (self->tex)
+		SDL_DestroyTexture(self->tex);
+	if (self->rend)
+		SDL_DestroyRenderer(self->rend);
+	if (self->win)
+		SDL_DestroyWindow(self->win);
+	free(self);
+}
+
+Sink *sink_sdl_create(const char *title, int win_width, int win_height) {
+	SinkSDL *self = malloc(sizeof(SinkSDL));
+	if (!self) return NULL;
+	*self = (SinkSDL){
+		.base = {
+			.get_size = sink_sdl_get_size,
+			.present = sink_sdl_present,
+			.destroy = sink_sdl_destroy,
+		},
+	};
+	self->win = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, win_width, win_height, SDL_WINDOW_RESIZABLE);
+	if (!self->win) {
+		printf("SDL_CreateWindow failed: %s\n", SDL_GetError());
+		sink_sdl_destroy(self);
+		return NULL;
+	}
+	self->rend = SDL_CreateRenderer(self->win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	if (!self->rend) {
+		printf("SDL_CreateRenderer failed: %s\n", SDL_GetError());
+		sink_sdl_destroy(self);
+		return NULL;
+	}
+	return (Sink*)self;
+}
+
+// Errors go to stderr, stdout may be the stream itself.
+typedef struct {
+	Sink base;
+	FILE *f;
+	bool y4m;
+	double fps;
+	int width; // 0 until the first frame
+	int height;
+	uint8_t *buf; // converted frame (y4m) or row (rgba)
+} SinkFile;
+
+static int sink_file_write_y4m(SinkFile *self, const uint32_t *pxdata) {
+	size_t n = (size_t)self->width * self->height;
+	uint8_t *y_plane = self->buf;
+	uint8_t *u_plane = y_plane + n;
+	uint8_t *v_plane = u_plane + n;
+	// BT.601, limited range
+	for (size_t i = 0; i < n; ++i) {
+		int r = pxdata[i] >> 24 & 0xFF;
+		int g = pxdata[i] >> 16 & 0xFF;
+		int b = pxdata[i] >> 8 & 0xFF;
+		y_plane[i] = ((66*r + 129*g + 25*b + 128) >> 8) + 16;
+		u_plane[i] = ((-38*r - 74*g + 112*b + 128) >> 8) + 128;
+		v_plane[i] = ((112*r - 94*g - 18*b + 128) >> 8) + 128;
+	}
+	if (fputs("FRAME\n", self->f) == EOF)
+		return -1;
+	return fwrite(self->buf, 3, n, self->f) == n ? 0 : -1;
+}
+
+static int sink_file_write_rgba(SinkFile *self, const uint32_t *pxdata) {
+	for (int y = 0; y < self->height; ++y) {
+		const uint32_t *row = pxdata + (size_t)y*self->width;
+		for (int x = 0; x < self->width; ++x) {
+			self->buf[4*x + 0] = row[x] >> 24;
+			self->buf[4*x + 1] = row[x] >> 16;
+			self->buf[4*x + 2] = row[x] >> 8;
+			self->buf[4*x + 3] = row[x];
+		}
+		if (fwrite(self->buf, 4, self->width, self->f) != (size_t)self->width)
+			return -1;
+	}
+	return 0;
+}
+
+static bool sink_no_size(void *self, int *width, int *height) {
+	return false;
+}
+
+static int sink_file_present(void *_self, const uint32_t *pxdata, int width, int height) {
+	SinkFile *self = _self;
+	if (!self->width) {
+		self->width = width;
+		self->height = height;
+		self->buf = malloc(self->y4m ? (size_t)width * height * 3 : (size_t)width * 4);
+		if (!self->buf) {
+			fprintf(stderr, "malloc failed\n");
+			return -1;
+		}
+		if (self->y4m)
+			fprintf(self->f, "YUV4MPEG2 W%d H%d F%ld:1000 Ip A1:1 C444\n", width, height, lround(self->fps * 1000.0));
+	} else if (width != self->width || height != self->height) {
+		fprintf(stderr, "output stream cannot change frame size (%dx%d -> %dx%d)\n", self->width, self->height, width, height);
+		return -1;
+	}
+
+	int ret = self->y4m ? sink_file_write_y4m(self, pxdata) : sink_file_write_rgba(self, pxdata);
+	if (ret != 0)
+		fprintf(stderr, "writing frame failed: %s\n", strerror(errno));
+	return ret;
+}
+
+static void sink_file_destroy(void *_self) {
+	SinkFile *self = _self;
+	if (self->f && self->f != stdout)
+		fclose(self->f);
+	else if (self->f)
+		fflush(self->f);
+	free(self->buf);
+	free(self);
+}
+
+static Sink *sink_file_create(const char *path, bool y4m, double fps) {
+	SinkFile *self = malloc(sizeof(SinkFile));
+	if (!self) return NULL;
+	*self = (SinkFile){
+		.base = {
+			.get_size = sink_no_size,
+			.present = sink_file_present,
+			.destroy = sink_file_destroy,
+		},
+		.y4m = y4m,
+		.fps = fps,
+	};
+	if (!path || strcmp(path, "-") == 0) {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		self->f = stdout;
+	} else {
+		self->f = fopen(path, "wb");
+		if (!self->f) {
+			fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+			sink_file_destroy(self);
+			return NULL;
+		}
+	}
+#ifdef SIGPIPE
+	// A reader going away should end playback with an error, not kill us.
+	signal(SIGPIPE, SIG_IGN);
+#endif
+	return (Sink*)self;
+}
+
+Sink *sink_y4m_create(const char *path, double fps) {
+	return sink_file_create(path, true, fps);
+}
+
+Sink *sink_rgba_create(const char *path) {
+	return sink_file_create(path, false, 0.0);
+}
+
+typedef struct {
+	Sink base;
+	size_t n_frames;
+} SinkNull;
+
+static int sink_null_present(void *_self, const uint32_t *pxdata, int width, int height) {
+	SinkNull *self = _self;
+	++self->n_frames;
+	return 0;
+}
+
+static void sink_null_destroy(void *_self) {
+	free(_self);
+}
+
+Sink *sink_null_create(void) {
+	SinkNull *self = malloc(sizeof(SinkNull));
+	if (!self) return NULL;
+	*self = (SinkNull){
+		.base = {
+			.get_size = sink_no_size,
+			.present = sink_null_present,
+			.destroy = sink_null_destroy,
+		},
+	};
+	return (Sink*)self;
+}
@@ -0,0 +1,41 @@
+#ifndef __SINK_H__
+#define __SINK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Destination for rendered frames.
+// Pixels are passed as packed RGBA8888 (see rgba_to_u32() in render.h),
+// row after row without padding. Sinks only borrow the pixel buffer for
+// the duration of the present() call.
+typedef struct Sink {
+	// Native frame size, e.g. of the window. Returns false if there is none.
+	bool (*get_size)(void *self, int *width, int *height);
+	// Returns 0 on success.
+	int (*present)(void *self, const uint32_t *pxdata, int width, int height);
+	void (*destroy)(void *self);
+} Sink;
+
+static inline bool sink_get_size(Sink *self, int *width, int *height) {
+	return self->get_size(self, width, height);
+}
+
+static inline int sink_present(Sink *self, const uint32_t *pxdata, int width, int height) {
+	return self->present(self, pxdata, width, height);
+}
+
+static inline void sink_destroy(Sink *self) {
+	self->destroy(self);
+}
+
+// SDL window, requires SDL_INIT_VIDEO.
+Sink *sink_sdl_create(const char *title, int win_width, int win_height);
+// YUV4MPEG2 (4:4:4) stream, e.g. for piping into ffmpeg or mpv.
+// A path of NULL or "-" writes to stdout, named pipes work like any other path.
+Sink *sink_y4m_create(const char *path, double fps);
+// Raw RGBA stream, 4 bytes per pixel in R, G, B, A order.
+Sink *sink_rgba_create(const char *path);
+// Discards all frames, for benchmarking.
+Sink *sink_null_create(void);
+
+#endif // __SINK_H__